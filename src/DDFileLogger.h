@@ -15,6 +15,8 @@
 // maximumFileSize         -> DEFAULT_LOG_MAX_FILE_SIZE
 // rollingFrequency        -> DEFAULT_LOG_ROLLING_FREQUENCY
 // maximumNumberOfLogFiles -> DEFAULT_LOG_MAX_NUM_LOG_FILES
+// indexByteInterval       -> DEFAULT_LOG_INDEX_BYTE_INTERVAL
+// indexTimeInterval       -> DEFAULT_LOG_INDEX_TIME_INTERVAL
 // 
 // You should carefully consider the proper configuration values for your application.
 
@@ -22,6 +24,9 @@
 #define DEFAULT_LOG_ROLLING_FREQUENCY (60 * 60 * 24)  // 24 Hours
 #define DEFAULT_LOG_MAX_NUM_LOG_FILES (5)             //  5 Files
 
+#define DEFAULT_LOG_INDEX_BYTE_INTERVAL (64 * 1024)   // 64 KB
+#define DEFAULT_LOG_INDEX_TIME_INTERVAL (1)           //  1 Second
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #pragma mark -
@@ -79,6 +84,22 @@
 - (void)didArchiveLogFile:(OFString *)logFilePath;
 - (void)didRollAndArchiveLogFile:(OFString *)logFilePath;
 
+// Querying
+// 
+// Returns the log lines written between startDate and endDate whose log flag is part of the logLevel bitmask.
+// Either date may be nil for an open bound. The lines are ordered from oldest to newest.
+// 
+// The level filter is exact, but the dates are not.
+// Lines are selected in whole index blocks (see indexTimeInterval and indexByteInterval in DDFileLogger),
+// so lines written up to one block before startDate or after endDate may be returned as well.
+// With the default configuration that is at most about one second on either side.
+// If exact bounds matter, check the timestamps written by your log formatter.
+// 
+// For example, every warning and error from the last 5 minutes:
+// [logFileManager logLinesFromDate:[OFDate dateWithTimeIntervalSinceNow:-300] toDate:nil logLevel:LOG_LEVEL_WARN];
+
+- (OFArray *)logLinesFromDate:(OFDate *)startDate toDate:(OFDate *)endDate logLevel:(int)logLevel;
+
 @end
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -95,6 +116,12 @@
 // where uuid is a 6 character hexadecimal consisting of the set [0123456789ABCDEF].
 // 
 // Archived log files are automatically deleted according to the maximumNumberOfLogFiles property.
+// 
+// Each log file written by DDFileLogger is accompanied by a sparse index named "log-<uuid>.idx".
+// The logLinesFromDate:toDate:logLevel: method uses it to seek straight to the requested time range,
+// so only the matching parts of the log files are ever read. Log files without an index are not searched.
+// A log file resumed without an index (for example one written by an older version) stays unindexed until it is rolled.
+// Index files whose log file has been removed are deleted along with the old log files.
 
 @interface DDLogFileManagerDefault : OFObject <DDLogFileManager>
 {
@@ -134,6 +161,7 @@
 	
 	DDLogFileInfo *currentLogFileInfo;
 	OFFile *currentLogFileHandle;
+	OFFile *currentIndexFileHandle;
 	
 	OFTimer *rollingTimer;
 	
@@ -141,6 +169,15 @@
 	size_t _currentBufferSize;
 	of_time_interval_t _lastBufferFlush;
 	of_time_interval_t _rollingFrequency;
+	
+	uint64_t _indexByteInterval;
+	of_time_interval_t _indexTimeInterval;
+	uint64_t _currentFileOffset;
+	uint64_t _indexBlockOffset;
+	uint64_t _indexBlockTimestamp;
+	int _indexBlockFlag;
+	bool _hasIndexBlock;
+	bool _indexFileFailed;
 }
 
 - (id)init;
@@ -167,6 +204,13 @@
 // The log file will be rolled at that 20 hour mark.
 // A new log file will be created, and the 24 hour timer will be restarted.
 // 
+// indexByteInterval
+// indexTimeInterval
+//   While writing, a sparse index is kept next to the log file, mapping timestamps to byte offsets.
+//   A new index entry is started once the current one covers indexByteInterval bytes,
+//   or indexTimeInterval seconds, or when the log flag changes from one message to the next.
+//   Smaller values make range queries more precise at the cost of a larger index.
+// 
 // logFileManager
 //   Allows you to retrieve the list of log files,
 //   and configure the maximum number of archived log files to keep.
@@ -175,6 +219,10 @@
 
 @property (readwrite, assign) of_time_interval_t rollingFrequency;
 
+@property (readwrite, assign) uint64_t indexByteInterval;
+
+@property (readwrite, assign) of_time_interval_t indexTimeInterval;
+
 @property (nonatomic, readonly) id <DDLogFileManager> logFileManager;
 
 @end
@@ -212,6 +260,8 @@
 @property (nonatomic, readonly) OFString *filePath;
 @property (nonatomic, readonly) OFString *fileName;
 
+@property (nonatomic, readonly) OFString *indexFilePath;
+
 @property (nonatomic, readonly) OFDictionary *fileAttributes;
 
 @property (nonatomic, readonly) OFDate *creationDate;
@@ -8,6 +8,36 @@
 //#import <sys/attr.h>
 //#import <sys/xattr.h>
 
+#include <stdio.h>
+#include <string.h>
+
+// Can we map files into memory?
+// 
+// Log queries map the parts of the log files they scan where mmap is available,
+// and read them with OFFile everywhere else.
+// Define MMAP_AVAILABLE to 0 or 1 to override the detection.
+
+#if !defined(MMAP_AVAILABLE)
+  #if defined(__unix__) || defined(__unix) || (defined(__APPLE__) && defined(__MACH__))
+    #include <unistd.h>
+  #endif
+  #if defined(_POSIX_MAPPED_FILES) && (_POSIX_MAPPED_FILES > 0)
+    #define MMAP_AVAILABLE 1
+  #else
+    #define MMAP_AVAILABLE 0
+  #endif
+#endif
+
+#if MMAP_AVAILABLE
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#if !defined(O_CLOEXEC)
+#define O_CLOEXEC 0
+#endif
+#endif
+
 // We probably shouldn't be using DDLog() statements within the DDLog implementation.
 // But we still want to leave our log statements for any future debugging,
 // and to allow other developers to trace the implementation (which is a great learning tool).
@@ -22,13 +52,130 @@
 #define NSLogInfo(frmt, ...)     do{ if(LOG_LEVEL >= 3) of_log((frmt), ##__VA_ARGS__); } while(0)
 #define NSLogVerbose(frmt, ...)  do{ if(LOG_LEVEL >= 4) of_log((frmt), ##__VA_ARGS__); } while(0)
 
+// The sidecar index is a flat array of fixed size entries, stored little endian.
+// 
+// Each entry starts a block of the log file at the given byte offset.
+// All messages in a block share the same log flag, and the block ends where the next entry begins.
+// Timestamps are microseconds since 1970 and never decrease from one entry to the next,
+// which allows the query code to binary search them.
+
+typedef struct
+{
+	uint64_t timestamp;
+	uint64_t offset;
+	uint32_t flag;
+	uint32_t reserved;
+} DDLogIndexEntry;
+
+// A read-only view of part of a file.
+// Where mmap is available the region is mapped, so only the pages actually scanned are read from disk.
+
+typedef struct
+{
+	void *base;
+	size_t baseLength;
+	const char *bytes;
+	size_t length;
+} DDLogFileRegion;
+
+static bool DDLogFileRegionOpen(DDLogFileRegion *region, OFString *filePath, uint64_t offset, uint64_t length)
+{
+	memset(region, 0, sizeof(DDLogFileRegion));
+	
+	if (length == 0 || length > SIZE_MAX)
+	{
+		return false;
+	}
+	
+#if MMAP_AVAILABLE
+	
+	int fd = open([filePath UTF8String], O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return false;
+	}
+	
+	uint64_t pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+	uint64_t alignedOffset = offset - (offset % pageSize);
+	size_t baseLength = (size_t)(length + (offset - alignedOffset));
+	
+	void *base = mmap(NULL, baseLength, PROT_READ, MAP_SHARED, fd, (off_t)alignedOffset);
+	close(fd);
+	
+	if (base == MAP_FAILED)
+	{
+		return false;
+	}
+	
+	region->base = base;
+	region->baseLength = baseLength;
+	region->bytes = (const char *)base + (offset - alignedOffset);
+	region->length = (size_t)length;
+	
+	return true;
+	
+#else
+	
+	void *base = malloc((size_t)length);
+	if (base == NULL)
+	{
+		return false;
+	}
+	
+	@try {
+		OFFile *file = [OFFile fileWithPath:filePath mode:@"rb"];
+		[file seekToOffset:(of_offset_t)offset whence:SEEK_SET];
+		[file readIntoBuffer:base exactLength:(size_t)length];
+		[file close];
+	}@catch(OFException* e) {
+		NSLogError(@"DDLogFileManagerDefault: Error reading file (%@): %@", filePath, e);
+		free(base);
+		return false;
+	}
+	
+	region->base = base;
+	region->baseLength = (size_t)length;
+	region->bytes = (const char *)base;
+	region->length = (size_t)length;
+	
+	return true;
+	
+#endif
+}
+
+static void DDLogFileRegionClose(DDLogFileRegion *region)
+{
+	if (region->base == NULL)
+	{
+		return;
+	}
+	
+#if MMAP_AVAILABLE
+	munmap(region->base, region->baseLength);
+#else
+	free(region->base);
+#endif
+	
+	memset(region, 0, sizeof(DDLogFileRegion));
+}
+
 @interface DDLogFileManagerDefault (PrivateAPI)
 - (void)deleteOldLogFiles;
+- (void)deleteOrphanedIndexFiles;
+- (void)addLogLinesFromLogFile:(DDLogFileInfo *)logFileInfo
+                 fromTimestamp:(uint64_t)startTimestamp
+                   toTimestamp:(uint64_t)endTimestamp
+                      logLevel:(int)logLevel
+                       toArray:(OFMutableArray *)logLines;
 @end
 
 @interface DDFileLogger (PrivateAPI)
 - (void)maybeRollLogFileDueToAge:(OFTimer *)aTimer;
 - (void)maybeRollLogFileDueToSize;
+- (void)maybeAddIndexEntryForLogMessage:(DDLogMessage *)logMessage;
+- (size_t)prepareIndexFileForAppendingAtPath:(OFString *)indexFilePath logFileSize:(uint64_t)logFileSize;
+- (void)closeCurrentIndexFileHandle;
+- (void)discardCurrentIndexFile;
 @end
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -161,6 +308,64 @@
 			[[OFFileManager defaultManager] removeItemAtPath:logFileInfo.filePath];
 		}
 	}
+	
+	// This also takes care of the indexes of the log files deleted above.
+	[self deleteOrphanedIndexFiles];
+}
+
+/**
+ * Deletes index files whose log file no longer exists.
+ * 
+ * The index files are not part of any of the log file listings,
+ * so without this they would pile up whenever a log file is removed by something other than deleteOldLogFiles.
+**/
+- (void)deleteOrphanedIndexFiles
+{
+	OFString *logsDirectory = [self logsDirectory];
+	
+	OFArray *fileNames = [[OFFileManager defaultManager] contentsOfDirectoryAtPath:logsDirectory];
+	
+	for (OFString *fileName in fileNames)
+	{
+		if (![fileName hasPrefix:@("log-")])
+		{
+			continue;
+		}
+		
+		OFString *filePath = [logsDirectory stringByAppendingPathComponent:fileName];
+		
+		// Temporary files are left behind by a crash while an index was being cut back (see DDFileLogger).
+		
+		if ([fileName hasSuffix:@(".idx.tmp")])
+		{
+			@try {
+				[[OFFileManager defaultManager] removeItemAtPath:filePath];
+			}@catch(OFException* e) {
+				NSLogError(@"DDLogFileManagerDefault: Error deleting temporary index file (%@): %@", fileName, e);
+			}
+			
+			continue;
+		}
+		
+		if (![fileName hasSuffix:@(".idx")])
+		{
+			continue;
+		}
+		
+		OFString *logFilePath = [filePath substringWithRange:of_range(0, [filePath length] - 4)];
+		logFilePath = [logFilePath stringByAppendingString:@".txt"];
+		
+		if (![[OFFileManager defaultManager] fileExistsAtPath:logFilePath])
+		{
+			NSLogInfo(@"DDLogFileManagerDefault: Deleting orphaned index file: %@", fileName);
+			
+			@try {
+				[[OFFileManager defaultManager] removeItemAtPath:filePath];
+			}@catch(OFException* e) {
+				NSLogError(@"DDLogFileManagerDefault: Error deleting index file (%@): %@", fileName, e);
+			}
+		}
+	}
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -219,13 +424,16 @@
 	// A log file has a name like "log-<uuid>.txt", where <uuid> is a HEX-string of 6 characters.
 	// 
 	// For example: log-DFFE99.txt
+	// 
+	// The suffix check keeps the sidecar index files (log-DFFE99.idx) out of the list.
 	//void* pool = objc_autoreleasePoolPush();
 	bool hasProperPrefix = [fileName hasPrefix:@("log-")];
+	bool hasProperSuffix = [fileName hasSuffix:@(".txt")];
 	
 	bool hasProperLength = [fileName length] >= 10;
 	
 	
-	if (hasProperPrefix && hasProperLength)
+	if (hasProperPrefix && hasProperSuffix && hasProperLength)
 	{
 		const of_unichar_t* chars = [@("0123456789ABCDEF") characters];
 		
@@ -399,11 +607,19 @@
 	OFString *logsDirectory = [self logsDirectory];
 	do
 	{
-		OFString *fileName = [OFString stringWithFormat:@"log-%@.txt", [self generateShortUUID]];
+		OFString *uuid = [self generateShortUUID];
+		
+		OFString *fileName = [OFString stringWithFormat:@"log-%@.txt", uuid];
+		OFString *indexFileName = [OFString stringWithFormat:@"log-%@.idx", uuid];
 		
 		OFString *filePath = [logsDirectory stringByAppendingPathComponent:fileName];
+		OFString *indexFilePath = [logsDirectory stringByAppendingPathComponent:indexFileName];
+		
+		// A leftover index with the same name counts as a collision too,
+		// otherwise DDFileLogger would adopt it as the index of the new log file.
 		
-		if (![[OFFileManager defaultManager] fileExistsAtPath:filePath])
+		if (![[OFFileManager defaultManager] fileExistsAtPath:filePath] &&
+		    ![[OFFileManager defaultManager] fileExistsAtPath:indexFilePath])
 		{
 			NSLogVerbose(@"DDLogFileManagerDefault: Creating new log file: %@", fileName);
 			
@@ -419,6 +635,209 @@
 	} while(true);
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Querying
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Returns the log lines written between startDate and endDate (either may be nil),
+ * whose log flag is part of the logLevel bitmask, ordered from oldest to newest.
+ * 
+ * The time range is only resolved to the blocks of the index (see indexTimeInterval in DDFileLogger),
+ * so lines up to one block outside of the requested range may be included.
+**/
+- (OFArray *)logLinesFromDate:(OFDate *)startDate toDate:(OFDate *)endDate logLevel:(int)logLevel
+{
+	uint64_t startTimestamp = 0;
+	uint64_t endTimestamp = UINT64_MAX;
+	
+	if (startDate && [startDate timeIntervalSince1970] > 0)
+		startTimestamp = (uint64_t)([startDate timeIntervalSince1970] * 1000000.0);
+	
+	if (endDate)
+		endTimestamp = (uint64_t)(OF_MAX([endDate timeIntervalSince1970], 0) * 1000000.0);
+	
+	OFMutableArray *logLines = [OFMutableArray array];
+	
+	if (startTimestamp > endTimestamp || logLevel == LOG_LEVEL_OFF)
+	{
+		[logLines makeImmutable];
+		return logLines;
+	}
+	
+	// The sorted log file infos are newest first, but the lines are returned oldest first.
+	
+	OFArray *sortedLogFileInfos = [self sortedLogFileInfos];
+	
+	for (size_t i = [sortedLogFileInfos count]; i > 0; i--)
+	{
+		DDLogFileInfo *logFileInfo = [sortedLogFileInfos objectAtIndex:(i - 1)];
+		
+		// A log file last written to before the start of the range can't contain anything of interest.
+		
+		if (startDate && [logFileInfo.modificationDate compare:startDate] == OF_ORDERED_ASCENDING)
+		{
+			continue;
+		}
+		
+		[self addLogLinesFromLogFile:logFileInfo
+		               fromTimestamp:startTimestamp
+		                 toTimestamp:endTimestamp
+		                    logLevel:logLevel
+		                     toArray:logLines];
+	}
+	
+	[logLines makeImmutable];
+	return logLines;
+}
+
+- (void)addLogLinesFromLogFile:(DDLogFileInfo *)logFileInfo
+                 fromTimestamp:(uint64_t)startTimestamp
+                   toTimestamp:(uint64_t)endTimestamp
+                      logLevel:(int)logLevel
+                       toArray:(OFMutableArray *)logLines
+{
+	OFFileManager *fileManager = [OFFileManager defaultManager];
+	
+	if (![fileManager fileExistsAtPath:logFileInfo.indexFilePath])
+	{
+		return;
+	}
+	
+	// The logging thread may roll or delete the file while we're reading it.
+	// If anything goes wrong the file is skipped, and none of its lines are returned.
+	
+	OFMutableArray *fileLogLines = [OFMutableArray array];
+	
+	DDLogFileRegion indexRegion;
+	DDLogFileRegion fileRegion;
+	
+	memset(&indexRegion, 0, sizeof(DDLogFileRegion));
+	memset(&fileRegion, 0, sizeof(DDLogFileRegion));
+	
+	@try {
+		uint64_t indexSize = (uint64_t)[fileManager sizeOfFileAtPath:logFileInfo.indexFilePath];
+		uint64_t fileSize = (uint64_t)[fileManager sizeOfFileAtPath:logFileInfo.filePath];
+		
+		// The last entry may still be half written if the logger is flushing right now.
+		
+		size_t count = (size_t)(indexSize / sizeof(DDLogIndexEntry));
+		
+		if (!DDLogFileRegionOpen(&indexRegion, logFileInfo.indexFilePath, 0, count * sizeof(DDLogIndexEntry)))
+		{
+			return;
+		}
+		
+		const DDLogIndexEntry *entries = (const DDLogIndexEntry *)indexRegion.bytes;
+		
+		// Find the block that contains startTimestamp,
+		// which is the last block starting at or before it.
+		
+		size_t low = 0;
+		size_t high = count;
+		
+		while (low < high)
+		{
+			size_t mid = low + (high - low) / 2;
+			
+			if (OF_BSWAP64_IF_BE(entries[mid].timestamp) <= startTimestamp)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		
+		size_t firstEntry = (low > 0) ? (low - 1) : 0;
+		
+		// Find the first block starting after endTimestamp.
+		
+		high = count;
+		
+		while (low < high)
+		{
+			size_t mid = low + (high - low) / 2;
+			
+			if (OF_BSWAP64_IF_BE(entries[mid].timestamp) <= endTimestamp)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		
+		size_t lastEntry = low;
+		
+		if (firstEntry >= lastEntry)
+		{
+			return;
+		}
+		
+		// The index and the log file are buffered independently,
+		// so the index may point slightly past the end of what has been written to the log file so far.
+		
+		uint64_t rangeStart = OF_MIN(OF_BSWAP64_IF_BE(entries[firstEntry].offset), fileSize);
+		uint64_t rangeEnd = fileSize;
+		
+		if (lastEntry < count)
+		{
+			rangeEnd = OF_MIN(OF_BSWAP64_IF_BE(entries[lastEntry].offset), fileSize);
+		}
+		
+		if (rangeEnd <= rangeStart ||
+		    !DDLogFileRegionOpen(&fileRegion, logFileInfo.filePath, rangeStart, rangeEnd - rangeStart))
+		{
+			return;
+		}
+		
+		// The live log file may end in the middle of a line (or even a multibyte character),
+		// so stop after the last complete line.
+		
+		while (rangeEnd > rangeStart && fileRegion.bytes[rangeEnd - rangeStart - 1] != '\n')
+		{
+			rangeEnd--;
+		}
+		
+		for (size_t i = firstEntry; i < lastEntry; i++)
+		{
+			if ((OF_BSWAP32_IF_BE(entries[i].flag) & logLevel) == 0)
+			{
+				continue;
+			}
+			
+			uint64_t blockStart = OF_MIN(OF_MAX(OF_BSWAP64_IF_BE(entries[i].offset), rangeStart), rangeEnd);
+			uint64_t blockEnd = rangeEnd;
+			
+			if (i + 1 < count)
+			{
+				blockEnd = OF_MIN(OF_MAX(OF_BSWAP64_IF_BE(entries[i + 1].offset), blockStart), rangeEnd);
+			}
+			
+			// Split the block into lines.
+			// memchr is vectorized by the C library, so this scans at close to memory bandwidth.
+			
+			const char *cursor = fileRegion.bytes + (blockStart - rangeStart);
+			const char *end = fileRegion.bytes + (blockEnd - rangeStart);
+			
+			while (cursor < end)
+			{
+				const char *newline = memchr(cursor, '\n', (size_t)(end - cursor));
+				const char *lineEnd = newline ? newline : end;
+				
+				if (lineEnd > cursor)
+				{
+					[fileLogLines addObject:[OFString stringWithUTF8String:cursor length:(size_t)(lineEnd - cursor)]];
+				}
+				
+				cursor = lineEnd + 1;
+			}
+		}
+		
+		[logLines addObjectsFromArray:fileLogLines];
+	}@catch(OFException* e) {
+		NSLogError(@"DDLogFileManagerDefault: Error querying log file (%@): %@", logFileInfo.fileName, e);
+	}@finally {
+		DDLogFileRegionClose(&fileRegion);
+		DDLogFileRegionClose(&indexRegion);
+	}
+}
+
 @end
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -468,6 +887,8 @@
 
 @synthesize maximumFileSize = _maximumFileSize;
 @synthesize rollingFrequency = _rollingFrequency;
+@synthesize indexByteInterval = _indexByteInterval;
+@synthesize indexTimeInterval = _indexTimeInterval;
 @synthesize logFileManager = _logFileManager;
 
 - (id)init
@@ -483,6 +904,8 @@
 	
 	self.maximumFileSize = DEFAULT_LOG_MAX_FILE_SIZE;
 	self.rollingFrequency = DEFAULT_LOG_ROLLING_FREQUENCY;
+	self.indexByteInterval = DEFAULT_LOG_INDEX_BYTE_INTERVAL;
+	self.indexTimeInterval = DEFAULT_LOG_INDEX_TIME_INTERVAL;
 		
 	_logFileManager = [aLogFileManager retain];
 		
@@ -509,6 +932,8 @@
 	[currentLogFileHandle close];
 	[currentLogFileHandle release];
 	
+	[self closeCurrentIndexFileHandle];
+	
 	[rollingTimer invalidate];
 	[rollingTimer release];
 	
@@ -625,6 +1050,11 @@
 	[currentLogFileHandle release];
 	currentLogFileHandle = nil;
 	
+	[self closeCurrentIndexFileHandle];
+	
+	// The next log file gets a fresh chance at having an index.
+	_indexFileFailed = false;
+	
 	currentLogFileInfo.isArchived = true;
 	
 	if ([_logFileManager respondsToSelector:@selector(didRollAndArchiveLogFile:)])
@@ -666,6 +1096,17 @@
 		shouldFlushBuffer = true;
 
 	if (shouldFlushBuffer) {
+		// The index goes first, so that every line on disk is covered by an index entry with the right flag.
+		// Entries pointing past the end of the log file are dropped when the log file is resumed.
+		
+		@try {
+			[currentIndexFileHandle flushWriteBuffer];
+		}@catch(OFException* e) {
+			NSLogError(@"DDFileLogger: Error flushing index file (%@): %@", currentLogFileInfo.indexFilePath, e);
+			
+			[self discardCurrentIndexFile];
+		}
+		
 		[currentLogFileHandle flushWriteBuffer];
 		_lastBufferFlush = current_timestamp;
 		_currentBufferSize = 0;
@@ -760,7 +1201,7 @@
 		
 		currentLogFileHandle = [[OFFile fileWithPath:logFilePath mode:@("a+")] retain];
 		[currentLogFileHandle setWriteBuffered:true];
-		[currentLogFileHandle seekToOffset:0 whence:SEEK_END];
+		_currentFileOffset = (uint64_t)[currentLogFileHandle seekToOffset:0 whence:SEEK_END];
 		
 		if (currentLogFileHandle)
 		{
@@ -771,6 +1212,245 @@
 	return currentLogFileHandle;
 }
 
+- (OFFile *)currentIndexFileHandle
+{
+	if (currentIndexFileHandle == nil && !_indexFileFailed)
+	{
+		OFString *indexFilePath = [[self currentLogFileInfo] indexFilePath];
+		
+		// Whatever is appended to the log file from now on starts a new block.
+		_hasIndexBlock = false;
+		_indexBlockOffset = 0;
+		_indexBlockTimestamp = 0;
+		_indexBlockFlag = 0;
+		
+		// The index is only an accelerator for queries, so failing to open it must not stop the logging.
+		// It isn't retried until the next log file, to avoid paying for the failure on every message.
+		
+		@try {
+			size_t count = [self prepareIndexFileForAppendingAtPath:indexFilePath logFileSize:_currentFileOffset];
+			
+			// A log file that already has content but no index to go with it (written by an older version,
+			// or its index was discarded) is left unindexed.
+			// Starting an index halfway would silently hide everything before the first entry from queries.
+			
+			if (count == 0 && _currentFileOffset > 0)
+			{
+				NSLogInfo(@"DDFileLogger: Not indexing log file without an index: %@", currentLogFileInfo.fileName);
+				
+				[self discardCurrentIndexFile];
+			}
+			else
+			{
+				currentIndexFileHandle = [[OFFile fileWithPath:indexFilePath mode:@("ab")] retain];
+				[currentIndexFileHandle setWriteBuffered:true];
+			}
+		}@catch(OFException* e) {
+			NSLogError(@"DDFileLogger: Error opening index file (%@): %@", indexFilePath, e);
+			
+			[self discardCurrentIndexFile];
+		}
+	}
+	
+	return currentIndexFileHandle;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark File Indexing
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Makes an existing index safe to append to when logging resumes with an existing log file,
+ * and returns the number of entries it holds.
+ * 
+ * A crash may have left a partial entry at the end of the index, which would misalign every entry appended after it.
+ * It may also have left entries for lines that never made it into the log file, because the index is flushed first.
+ * So the index is cut back to the whole entries that point inside the log file.
+ * The last remaining entry then seeds the current block, so that new timestamps are clamped against it
+ * and the index stays sorted even if the clock was set back across the restart.
+**/
+- (size_t)prepareIndexFileForAppendingAtPath:(OFString *)indexFilePath logFileSize:(uint64_t)logFileSize
+{
+	OFFileManager *fileManager = [OFFileManager defaultManager];
+	
+	if (![fileManager fileExistsAtPath:indexFilePath])
+	{
+		return 0;
+	}
+	
+	uint64_t indexSize = (uint64_t)[fileManager sizeOfFileAtPath:indexFilePath];
+	size_t count = (size_t)(indexSize / sizeof(DDLogIndexEntry));
+	
+	OFFile *indexFile = [OFFile fileWithPath:indexFilePath mode:@("rb")];
+	
+	while (count > 0)
+	{
+		[indexFile seekToOffset:(of_offset_t)((count - 1) * sizeof(DDLogIndexEntry)) whence:SEEK_SET];
+		
+		_indexBlockTimestamp = [indexFile readLittleEndianInt64];
+		_indexBlockOffset = [indexFile readLittleEndianInt64];
+		_indexBlockFlag = (int)[indexFile readLittleEndianInt32];
+		
+		if (_indexBlockOffset <= logFileSize)
+		{
+			break;
+		}
+		
+		count--;
+	}
+	
+	[indexFile close];
+	
+	if (count == 0)
+	{
+		_indexBlockTimestamp = 0;
+		_indexBlockOffset = 0;
+		_indexBlockFlag = 0;
+	}
+	
+	uint64_t validSize = (uint64_t)count * sizeof(DDLogIndexEntry);
+	
+	if (validSize != indexSize)
+	{
+		NSLogWarn(@"DDFileLogger: Truncating index file to %u entries: %@", (unsigned)count, indexFilePath);
+		
+		// The whole entries are written to a temporary file, which then replaces the index in one rename.
+		// Truncating in place could crash a concurrent query that has the index mapped,
+		// and a crash halfway through would lose the entire index.
+		// The index is small compared to the log file, and this only happens after a crash.
+		
+		OFString *temporaryFilePath = [indexFilePath stringByAppendingString:@".tmp"];
+		void *buffer = NULL;
+		
+		@try {
+			if (validSize > 0)
+			{
+				buffer = malloc((size_t)validSize);
+				
+				if (buffer == NULL)
+				{
+					@throw [OFOutOfMemoryException exceptionWithRequestedSize:(size_t)validSize];
+				}
+				
+				indexFile = [OFFile fileWithPath:indexFilePath mode:@("rb")];
+				[indexFile readIntoBuffer:buffer exactLength:(size_t)validSize];
+				[indexFile close];
+			}
+			
+			indexFile = [OFFile fileWithPath:temporaryFilePath mode:@("wb")];
+			
+			if (validSize > 0)
+			{
+				[indexFile writeBuffer:buffer length:(size_t)validSize];
+			}
+			
+			[indexFile close];
+			
+			// rename() atomically replaces the index where the platform allows it.
+			// moveItemAtPath: refuses to overwrite an existing file, so it's only the fallback.
+			
+			if (rename([temporaryFilePath UTF8String], [indexFilePath UTF8String]) != 0)
+			{
+				[fileManager removeItemAtPath:indexFilePath];
+				[fileManager moveItemAtPath:temporaryFilePath toPath:indexFilePath];
+			}
+		}@finally {
+			free(buffer);
+		}
+	}
+	
+	return count;
+}
+
+/**
+ * Starts a new index block at the current end of the log file if the message doesn't fit in the current block.
+ * 
+ * A block is closed once it covers indexByteInterval bytes or indexTimeInterval seconds,
+ * and whenever the log flag changes, so that queries can skip entire blocks based on the log level.
+**/
+- (void)maybeAddIndexEntryForLogMessage:(DDLogMessage *)logMessage
+{
+	OFFile *indexFileHandle = [self currentIndexFileHandle];
+	
+	if (indexFileHandle == nil)
+	{
+		return;
+	}
+	
+	uint64_t timestamp = (uint64_t)(OF_MAX([logMessage.timestamp timeIntervalSince1970], 0) * 1000000.0);
+	
+	// Messages from different threads may reach us slightly out of order,
+	// and the clock may have been set back since the last entry was written.
+	// Keep the index timestamps increasing so that they can be binary searched.
+	
+	if (timestamp < _indexBlockTimestamp)
+	{
+		timestamp = _indexBlockTimestamp;
+	}
+	
+	if (_hasIndexBlock &&
+	    logMessage.logFlag == _indexBlockFlag &&
+	    (_currentFileOffset - _indexBlockOffset) < self.indexByteInterval &&
+	    (timestamp - _indexBlockTimestamp) < (uint64_t)(self.indexTimeInterval * 1000000.0))
+	{
+		return;
+	}
+	
+	@try {
+		[indexFileHandle writeLittleEndianInt64:timestamp];
+		[indexFileHandle writeLittleEndianInt64:_currentFileOffset];
+		[indexFileHandle writeLittleEndianInt32:(uint32_t)logMessage.logFlag];
+		[indexFileHandle writeLittleEndianInt32:0];
+	}@catch(OFException* e) {
+		NSLogError(@"DDFileLogger: Error writing index file (%@): %@", currentLogFileInfo.indexFilePath, e);
+		
+		[self discardCurrentIndexFile];
+		return;
+	}
+	
+	_indexBlockOffset = _currentFileOffset;
+	_indexBlockTimestamp = timestamp;
+	_indexBlockFlag = logMessage.logFlag;
+	_hasIndexBlock = true;
+}
+
+- (void)closeCurrentIndexFileHandle
+{
+	@try {
+		[currentIndexFileHandle close];
+	}@catch(OFException* e) {
+		NSLogError(@"DDFileLogger: Error closing index file (%@): %@", currentLogFileInfo.indexFilePath, e);
+	}
+	
+	[currentIndexFileHandle release];
+	currentIndexFileHandle = nil;
+}
+
+/**
+ * Gives up on the index of the current log file after an I/O error.
+ * 
+ * An index with missing or partial entries would make queries return wrong ranges,
+ * so it is deleted, and no index is kept for the rest of this log file.
+ * Queries then simply skip the log file.
+**/
+- (void)discardCurrentIndexFile
+{
+	[self closeCurrentIndexFileHandle];
+	
+	_indexFileFailed = true;
+	
+	OFString *indexFilePath = currentLogFileInfo.indexFilePath;
+	
+	@try {
+		if (indexFilePath && [[OFFileManager defaultManager] fileExistsAtPath:indexFilePath])
+		{
+			[[OFFileManager defaultManager] removeItemAtPath:indexFilePath];
+		}
+	}@catch(OFException* e) {
+		NSLogError(@"DDFileLogger: Error deleting index file (%@): %@", indexFilePath, e);
+	}
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #pragma mark DDLogger Protocol
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -786,17 +1466,23 @@
 	
 	if (logMsg)
 	{
+		OFFile *logFileHandle = [self currentLogFileHandle];
+		
+		[self maybeAddIndexEntryForLogMessage:logMessage];
+		
 		if (![logMsg hasSuffix:@"\n"])
 		{
-			[[self currentLogFileHandle] writeLine:logMsg];
+			[logFileHandle writeLine:logMsg];
 			_currentBufferSize += 1;
+			_currentFileOffset += 1;
 
 		} else {
-			[[self currentLogFileHandle] writeString:logMsg];
+			[logFileHandle writeString:logMsg];
 
 		}
 		
 		_currentBufferSize += [logMsg UTF8StringLength];
+		_currentFileOffset += [logMsg UTF8StringLength];
 		
 		[self maybeRollLogFileDueToSize];
 	}
@@ -836,6 +1522,7 @@
 @synthesize filePath = _filePath;
 
 @dynamic fileName;
+@dynamic indexFilePath;
 @dynamic fileAttributes;
 @dynamic creationDate;
 @dynamic modificationDate;
@@ -903,6 +1590,20 @@
 	return _fileName;
 }
 
+- (OFString *)indexFilePath
+{
+	// The index lives next to the log file: log-DFFE99.txt -> log-DFFE99.idx
+	
+	OFString *basePath = self.filePath;
+	
+	if ([basePath hasSuffix:@".txt"])
+	{
+		basePath = [basePath substringWithRange:of_range(0, [basePath length] - 4)];
+	}
+	
+	return [basePath stringByAppendingString:@".idx"];
+}
+
 - (OFDate *)modificationDate
 {
 	if (_modificationDate == nil)